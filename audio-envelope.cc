@@ -0,0 +1,288 @@
+#include "audio-envelope.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static const char kSidecarMagic[8] = { 'N','O','O','D','E','N','V','1' };
+
+// Header of the sidecar file, followed by the envelope_frame_t array.
+struct envelope_header_t {
+    char magic[8];
+    uint64_t source_hash;   // Hash of the sound file this was created from.
+    uint32_t frame_ms;
+    uint32_t bands;
+    uint32_t frame_count;
+    uint32_t reserved;
+};
+
+// Map the whole file read-only. Returns NULL on failure.
+static void *MapFile(const std::string &filename, size_t *size) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *result = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        result = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (result == MAP_FAILED) result = NULL;
+        *size = st.st_size;
+    }
+    close(fd);
+    return result;
+}
+
+// 64 bit FNV-1a
+static uint64_t HashBytes(const uint8_t *data, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint32_t LE32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t LE16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+// Decode uncompressed 8 or 16 bit WAV into mono samples in range -1..1.
+// Returns sample rate or 0 if this is not a WAV we understand.
+static int DecodeWav(const uint8_t *data, size_t len,
+                     std::vector<float> *samples) {
+    if (len < 12 || memcmp(data, "RIFF", 4) != 0
+        || memcmp(data + 8, "WAVE", 4) != 0)
+        return 0;
+    int channels = 0, rate = 0, bits = 0;
+    size_t pos = 12;
+    while (pos + 8 <= len) {
+        const uint8_t *chunk = data + pos;
+        const size_t chunk_len = std::min<size_t>(LE32(chunk + 4),
+                                                  len - pos - 8);
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_len >= 16) {
+            if (LE16(chunk + 8) != 1) return 0;  // Only PCM
+            channels = LE16(chunk + 10);
+            rate = LE32(chunk + 12);
+            bits = LE16(chunk + 22);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (channels <= 0 || rate <= 0 || (bits != 8 && bits != 16))
+                return 0;
+            const int bytes = bits / 8;
+            const size_t count = chunk_len / (bytes * channels);
+            const uint8_t *sample = chunk + 8;
+            samples->resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                float sum = 0;
+                for (int c = 0; c < channels; ++c, sample += bytes) {
+                    sum += (bits == 8)
+                        ? (sample[0] - 128) / 128.0f
+                        : (int16_t) LE16(sample) / 32768.0f;
+                }
+                (*samples)[i] = sum / channels;
+            }
+            return rate;
+        }
+        pos += 8 + chunk_len + (chunk_len & 1);  // Chunks are word aligned.
+    }
+    return 0;
+}
+
+// In-place iterative radix-2 FFT on separate real and imaginary arrays.
+// The twiddle factors exp(-2*pi*i*k/n) for k < n/2 are passed in.
+static void FFT(int n, const float *tw_re, const float *tw_im,
+                float *re, float *im) {
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        const int half = len / 2;
+        const int step = n / len;
+        for (int start = 0; start < n; start += len) {
+            float *const a_re = re + start, *const a_im = im + start;
+            float *const b_re = a_re + half, *const b_im = a_im + half;
+            for (int k = 0; k < half; ++k) {
+                const float w_re = tw_re[k * step], w_im = tw_im[k * step];
+                const float t_re = b_re[k] * w_re - b_im[k] * w_im;
+                const float t_im = b_re[k] * w_im + b_im[k] * w_re;
+                b_re[k] = a_re[k] - t_re;
+                b_im[k] = a_im[k] - t_im;
+                a_re[k] += t_re;
+                a_im[k] += t_im;
+            }
+        }
+    }
+}
+
+// Compute the envelope for every ENVELOPE_FRAME_MS of the samples.
+static void Analyze(const std::vector<float> &samples, int rate,
+                    std::vector<envelope_frame_t> *result) {
+    const int frame_len = std::max(1, rate * ENVELOPE_FRAME_MS / 1000);
+    int n = 2;
+    while (n < frame_len) n <<= 1;
+
+    std::vector<float> window(frame_len), tw_re(n / 2), tw_im(n / 2);
+    for (int i = 0; i < frame_len; ++i)
+        window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / frame_len);  // Hann
+    for (int k = 0; k < n / 2; ++k) {
+        tw_re[k] = cosf(2 * M_PI * k / n);
+        tw_im[k] = -sinf(2 * M_PI * k / n);
+    }
+
+    const size_t frames = samples.size() / frame_len;
+    std::vector<float> rms(frames), bands(frames * ENVELOPE_BANDS);
+    std::vector<float> re(n), im(n);
+    for (size_t f = 0; f < frames; ++f) {
+        const float *const in = samples.data() + f * frame_len;
+        float sum = 0;
+        for (int i = 0; i < frame_len; ++i) {
+            sum += in[i] * in[i];
+            re[i] = in[i] * window[i];
+        }
+        rms[f] = sqrtf(sum / frame_len);
+        std::fill(re.begin() + frame_len, re.end(), 0.0f);
+        std::fill(im.begin(), im.end(), 0.0f);
+        FFT(n, tw_re.data(), tw_im.data(), re.data(), im.data());
+
+        // Octave band b covers bins [2^b, 2^(b+1)); bin 0 (DC) is ignored.
+        for (int b = 0; b < ENVELOPE_BANDS; ++b) {
+            float energy = 0;
+            const int end = std::min(2 << b, n / 2);
+            for (int k = 1 << b; k < end; ++k)
+                energy += re[k] * re[k] + im[k] * im[k];
+            bands[f * ENVELOPE_BANDS + b] = sqrtf(energy);
+        }
+    }
+
+    // Normalize to the loudest frame and band in the file.
+    const float max_rms = frames ? *std::max_element(rms.begin(), rms.end())
+                                 : 0;
+    const float max_band = frames ? *std::max_element(bands.begin(),
+                                                      bands.end())
+                                  : 0;
+    result->resize(frames);
+    for (size_t f = 0; f < frames; ++f) {
+        envelope_frame_t &out = (*result)[f];
+        out.loudness = max_rms > 0 ? 255 * rms[f] / max_rms : 0;
+        for (int b = 0; b < ENVELOPE_BANDS; ++b) {
+            const float band = bands[f * ENVELOPE_BANDS + b];
+            out.bands[b] = max_band > 0 ? 255 * band / max_band : 0;
+        }
+    }
+}
+
+// Write sidecar file atomically. Returns success.
+static bool WriteSidecar(const std::string &filename, uint64_t hash,
+                         const std::vector<envelope_frame_t> &frames) {
+    envelope_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kSidecarMagic, sizeof(header.magic));
+    header.source_hash = hash;
+    header.frame_ms = ENVELOPE_FRAME_MS;
+    header.bands = ENVELOPE_BANDS;
+    header.frame_count = frames.size();
+
+    const std::string tmp = filename + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (out == NULL) return false;
+    bool success = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (!frames.empty()) {
+        success &= fwrite(frames.data(), sizeof(frames[0]), frames.size(),
+                          out) == frames.size();
+    }
+    success &= (fclose(out) == 0);
+    if (success && rename(tmp.c_str(), filename.c_str()) == 0)
+        return true;
+    unlink(tmp.c_str());
+    return false;
+}
+
+AudioEnvelope *AudioEnvelope::FromSidecar(const std::string &sidecar,
+                                          uint64_t hash) {
+    size_t size;
+    void *mapping = MapFile(sidecar, &size);
+    if (mapping == NULL) return NULL;
+    const envelope_header_t *header = (const envelope_header_t*) mapping;
+    if (size < sizeof(*header)
+        || memcmp(header->magic, kSidecarMagic, sizeof(kSidecarMagic)) != 0
+        || header->source_hash != hash
+        || header->frame_ms != ENVELOPE_FRAME_MS
+        || header->bands != ENVELOPE_BANDS
+        || size != (sizeof(*header)
+                    + header->frame_count * sizeof(envelope_frame_t))) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    const envelope_frame_t *frames = (const envelope_frame_t*)
+        ((const char*) mapping + sizeof(*header));
+    return new AudioEnvelope(mapping, size, frames, header->frame_count);
+}
+
+AudioEnvelope *AudioEnvelope::Load(const std::string &wav_file,
+                                   const std::string &cache_dir) {
+    size_t wav_size;
+    void *wav = MapFile(wav_file, &wav_size);
+    if (wav == NULL) return NULL;
+    const uint8_t *const wav_data = (const uint8_t*) wav;
+    const uint64_t hash = HashBytes(wav_data, wav_size);
+
+    // Fast path: still valid envelope from previous run. Sidecars are not
+    // put next to the sounds, where they'd be mistaken for sounds with
+    // 'noodly sounds/*'.
+    char hash_name[32];
+    snprintf(hash_name, sizeof(hash_name), "/%016llx.envelope",
+             (unsigned long long) hash);
+    const std::string sidecar = cache_dir + hash_name;
+    AudioEnvelope *result = FromSidecar(sidecar, hash);
+    if (result != NULL) {
+        munmap(wav, wav_size);
+        return result;
+    }
+
+    std::vector<float> samples;
+    const int rate = DecodeWav(wav_data, wav_size, &samples);
+    munmap(wav, wav_size);
+    if (rate == 0)
+        return NULL;
+    std::vector<envelope_frame_t> frames;
+    Analyze(samples, rate, &frames);
+    mkdir(cache_dir.c_str(), 0755);  // Might exist already.
+    if (WriteSidecar(sidecar, hash, frames))
+        result = FromSidecar(sidecar, hash);
+    if (result == NULL) {
+        fprintf(stderr, "Can't write %s; keeping envelope in memory.\n",
+                sidecar.c_str());
+        result = new AudioEnvelope(&frames);
+    }
+    return result;
+}
+
+AudioEnvelope::AudioEnvelope(void *mapping, size_t mapping_size,
+                             const envelope_frame_t *frames, int frame_count)
+    : mapping_(mapping), mapping_size_(mapping_size),
+      frames_(frames), frame_count_(frame_count) {}
+
+AudioEnvelope::AudioEnvelope(std::vector<envelope_frame_t> *frames)
+    : mapping_(NULL), mapping_size_(0) {
+    in_memory_.swap(*frames);
+    frames_ = in_memory_.data();
+    frame_count_ = in_memory_.size();
+}
+
+AudioEnvelope::~AudioEnvelope() {
+    if (mapping_) munmap(mapping_, mapping_size_);
+}
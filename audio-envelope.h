@@ -0,0 +1,66 @@
+// Loudness and spectrum envelope of a sound file, to synchronize the
+// animation with the sound being played.
+//
+// The envelope is computed once per file and cached in a sidecar file
+// <hash>.envelope in a cache directory, keyed by a hash of the sound file
+// content. The sidecar is memory mapped, so looking up the level at any
+// point in time during playback is a single array access.
+
+#ifndef NOODLY_AUDIO_ENVELOPE_H_
+#define NOODLY_AUDIO_ENVELOPE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#define ENVELOPE_FRAME_MS 10     // Time resolution of the envelope.
+#define ENVELOPE_BANDS     8     // Octave bands in spectrum.
+
+// Level of one frame. Values are normalized to the loudest frame (bands: to
+// the loudest band) of the file, so 255 is as loud as it gets in this file.
+struct envelope_frame_t {
+    uint8_t loudness;               // RMS
+    uint8_t bands[ENVELOPE_BANDS];  // Lowest octave first.
+};
+
+class AudioEnvelope {
+public:
+    ~AudioEnvelope();
+
+    // Get the envelope for the given WAV file, either from its sidecar file
+    // in "cache_dir" or by analyzing it and writing the sidecar there. The
+    // directory is created if needed. Returns NULL if the file can't be read
+    // or is not an uncompressed 8 or 16 bit WAV.
+    static AudioEnvelope *Load(const std::string &wav_file,
+                               const std::string &cache_dir);
+
+    // Level at the given time since start of playback or NULL if beyond the
+    // end of the sound.
+    const envelope_frame_t *AtTime(int64_t usec) const {
+        const int64_t frame = usec / (ENVELOPE_FRAME_MS * 1000);
+        return (frame >= 0 && frame < frame_count_) ? &frames_[frame] : NULL;
+    }
+
+    int frame_count() const { return frame_count_; }
+
+private:
+    AudioEnvelope(void *mapping, size_t mapping_size,
+                  const envelope_frame_t *frames, int frame_count);
+    explicit AudioEnvelope(std::vector<envelope_frame_t> *frames);
+
+    // Map sidecar file if it exists and matches the source hash.
+    static AudioEnvelope *FromSidecar(const std::string &sidecar,
+                                      uint64_t hash);
+
+    // Either memory mapped sidecar or, if that could not be written,
+    // kept in memory.
+    void *const mapping_;
+    const size_t mapping_size_;
+    std::vector<envelope_frame_t> in_memory_;
+
+    const envelope_frame_t *frames_;
+    int frame_count_;
+};
+
+#endif  // NOODLY_AUDIO_ENVELOPE_H_
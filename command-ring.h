@@ -0,0 +1,50 @@
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// Push() and Pop() neither block nor call into the kernel, so the consumer
+// can be the render loop while the producer is some thread doing I/O.
+
+#ifndef NOODLY_COMMAND_RING_H_
+#define NOODLY_COMMAND_RING_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+template <typename T, uint32_t N>
+class CommandRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Size must be power of two");
+
+public:
+    CommandRing() : read_pos_(0), write_pos_(0) {}
+
+    // Producer only. Returns false if the ring is full.
+    bool Push(const T &value) {
+        const uint32_t pos = write_pos_.load(std::memory_order_relaxed);
+        if (pos - read_pos_.load(std::memory_order_acquire) == N)
+            return false;
+        slots_[pos % N] = value;
+        write_pos_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the ring is empty.
+    bool Pop(T *value) {
+        const uint32_t pos = read_pos_.load(std::memory_order_relaxed);
+        if (pos == write_pos_.load(std::memory_order_acquire))
+            return false;
+        *value = slots_[pos % N];
+        read_pos_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Positions only ever increase and wrap around. Padded to keep producer
+    // and consumer side on separate cache lines.
+    std::atomic<uint32_t> read_pos_;
+    char read_padding_[64];
+    std::atomic<uint32_t> write_pos_;
+    char write_padding_[64];
+    T slots_[N];
+};
+
+#endif  // NOODLY_COMMAND_RING_H_
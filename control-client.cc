@@ -0,0 +1,96 @@
+#include "control-client.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+ControlClient *ControlClient::Connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return NULL;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    return new ControlClient(fd);
+}
+
+ControlClient::ControlClient(int fd) : fd_(fd) {
+    memset(&status_, 0, sizeof(status_));
+}
+
+ControlClient::~ControlClient() {
+    close(fd_);
+}
+
+bool ControlClient::Request(const struct control_command_t &command) {
+    if (send(fd_, &command, sizeof(command), MSG_NOSIGNAL) != sizeof(command))
+        return false;
+    struct control_reply_t reply;
+    if (recv(fd_, &reply, sizeof(reply), 0) != sizeof(reply))
+        return false;
+    status_ = reply.status;
+    return reply.ok;
+}
+
+bool ControlClient::Pulse(int appendage) {
+    struct control_command_t command;
+    memset(&command, 0, sizeof(command));
+    command.request = CONTROL_PULSE;
+    command.appendage = appendage;
+    return Request(command);
+}
+
+bool ControlClient::SetPalette(uint32_t background,
+                               const uint32_t *colors, int count) {
+    if (count < 0 || count > NOODLY_CONTROL_MAX_COLORS) return false;
+    struct control_command_t command;
+    memset(&command, 0, sizeof(command));
+    command.request = CONTROL_SET_PALETTE;
+    command.palette.background = background;
+    command.palette.count = count;
+    memcpy(command.palette.colors, colors, count * sizeof(*colors));
+    return Request(command);
+}
+
+bool ControlClient::SetOrbSequence(const struct orb_sequence_t &sequence) {
+    struct control_command_t command;
+    memset(&command, 0, sizeof(command));
+    command.request = CONTROL_SET_ORB_SEQUENCE;
+    command.orb_sequence = sequence;
+    return Request(command);
+}
+
+bool ControlClient::SetIdle(int idle_sec, int repeat_sec) {
+    struct control_command_t command;
+    memset(&command, 0, sizeof(command));
+    command.request = CONTROL_SET_IDLE;
+    command.idle.idle_sec = idle_sec;
+    command.idle.repeat_sec = repeat_sec;
+    return Request(command);
+}
+
+bool ControlClient::ResetStats() {
+    struct control_command_t command;
+    memset(&command, 0, sizeof(command));
+    command.request = CONTROL_RESET_STATS;
+    return Request(command);
+}
+
+bool ControlClient::GetStatus(struct control_status_t *status) {
+    struct control_command_t command;
+    memset(&command, 0, sizeof(command));
+    command.request = CONTROL_GET_STATUS;
+    if (!Request(command))
+        return false;
+    *status = status_;
+    return true;
+}
@@ -0,0 +1,52 @@
+// Client library for show controllers to talk to a running noodly over the
+// local control channel (see control-protocol.h).
+
+#ifndef NOODLY_CONTROL_CLIENT_H_
+#define NOODLY_CONTROL_CLIENT_H_
+
+#include <stdint.h>
+
+#include "control-protocol.h"
+
+class ControlClient {
+public:
+    ~ControlClient();
+
+    // Connect to noodly listening on the given socket. Returns NULL on
+    // failure.
+    static ControlClient *Connect(const char *socket_path
+                                  = NOODLY_CONTROL_SOCKET);
+
+    // Start rainbow on the given appendage; CONTROL_PULSE_TOUCH behaves as
+    // if the touch sensor was touched.
+    bool Pulse(int appendage);
+
+    // Set background base color and rainbow colors (0xRRGGBB, outside in).
+    bool SetPalette(uint32_t background, const uint32_t *colors, int count);
+
+    // Set the sequence played on the eye orbs.
+    bool SetOrbSequence(const struct orb_sequence_t &sequence);
+
+    // Set idle behavior; an idle_sec of 0 switches off idle mode.
+    bool SetIdle(int idle_sec, int repeat_sec);
+
+    // Reset max frame time and frame time percentiles.
+    bool ResetStats();
+
+    // Get the current status of the render loop.
+    bool GetStatus(struct control_status_t *status);
+
+    // Status as returned with the last reply.
+    const struct control_status_t &last_status() const { return status_; }
+
+private:
+    explicit ControlClient(int fd);
+
+    // Send command and wait for reply. Returns the 'ok' of the reply.
+    bool Request(const struct control_command_t &command);
+
+    const int fd_;
+    struct control_status_t status_;
+};
+
+#endif  // NOODLY_CONTROL_CLIENT_H_
@@ -0,0 +1,101 @@
+// Shared data structures for the local control channel between noodly and
+// show controllers running on the same box, thus pure C.
+//
+// Protocol
+// Clients connect to the SOCK_SEQPACKET unix domain socket at
+// NOODLY_CONTROL_SOCKET. Each request is exactly one struct
+// control_command_t, answered by exactly one struct control_reply_t.
+// The socket is created with NOODLY_CONTROL_SOCKET_MODE, so any local
+// user may connect.
+//
+// --- CONTROL_PULSE ---
+// Start the rainbow on the given appendage. With CONTROL_PULSE_TOUCH,
+// behave as if the touch sensor was touched. Other appendages beyond the
+// ones noodly has are invalid.
+//
+// --- CONTROL_SET_PALETTE ---
+// Set the base color of the background wave and the rainbow colors
+// (starting from the outside in).
+//
+// --- CONTROL_SET_ORB_SEQUENCE ---
+// Set the sequence played on the eye orbs whenever a rainbow reaches the
+// eye or in idle mode.
+//
+// --- CONTROL_SET_IDLE ---
+// Seconds without touch until idle mode and seconds between idle repeats.
+// An idle time of 0 switches off idle mode.
+//
+// --- CONTROL_GET_STATUS ---
+// No-op; just returns the reply with the current status.
+//
+// --- CONTROL_RESET_STATS ---
+// Reset max_frame_usec and the frame time percentiles, so that they only
+// cover frames from now on. The percentiles are updated every
+// NOODLY_CONTROL_PERCENTILE_FRAMES frames.
+//
+// All commands but CONTROL_GET_STATUS are queued and applied by the render
+// loop at the next frame. 'ok' in the reply is 0 if the command was
+// invalid or the queue was full.
+
+#ifndef NOODLY_CONTROL_PROTOCOL_H_
+#define NOODLY_CONTROL_PROTOCOL_H_
+
+#include <stdint.h>
+
+#include "microorb-protocol.h"
+
+#define NOODLY_CONTROL_SOCKET "/tmp/noodly-control"
+#define NOODLY_CONTROL_SOCKET_MODE 0666
+#define NOODLY_CONTROL_MAX_COLORS 8
+#define NOODLY_CONTROL_PERCENTILE_FRAMES 10
+
+#define CONTROL_PULSE_TOUCH 0xff
+
+enum ControlRequest {
+  CONTROL_PULSE            = 0,
+  CONTROL_SET_PALETTE      = 1,
+  CONTROL_SET_ORB_SEQUENCE = 2,
+  CONTROL_SET_IDLE         = 3,
+  CONTROL_GET_STATUS       = 4,
+  CONTROL_RESET_STATS      = 5,
+};
+
+struct control_palette_t {
+  uint32_t background;     // 0xRRGGBB base color of background wave.
+  unsigned char count;     // Number of rainbow colors.
+  uint32_t colors[NOODLY_CONTROL_MAX_COLORS];  // 0xRRGGBB, outside in.
+};
+
+struct control_idle_t {
+  uint16_t idle_sec;
+  uint16_t repeat_sec;
+};
+
+struct control_command_t {
+  unsigned char request;    // enum ControlRequest
+  unsigned char appendage;  // CONTROL_PULSE: strip or CONTROL_PULSE_TOUCH
+  union {
+    struct control_palette_t palette;       // CONTROL_SET_PALETTE
+    struct orb_sequence_t orb_sequence;     // CONTROL_SET_ORB_SEQUENCE
+    struct control_idle_t idle;             // CONTROL_SET_IDLE
+  };
+};
+
+struct control_status_t {
+  uint32_t frames;             // Frames rendered.
+  uint32_t overruns;           // Frames that took longer than a frame period.
+  uint32_t max_frame_usec;     // Longest frame since start or reset.
+  uint32_t commands_applied;   // Commands applied by the render loop.
+  uint32_t commands_dropped;   // Commands rejected as queue was full.
+  uint32_t active_animations;  // Bit per appendage with running rainbow.
+  uint32_t p99_frame_usec;     // Percentiles of time between frame starts
+                               // since start or reset.
+  uint32_t p999_frame_usec;
+};
+
+struct control_reply_t {
+  unsigned char ok;
+  struct control_status_t status;
+};
+
+#endif  // NOODLY_CONTROL_PROTOCOL_H_
@@ -0,0 +1,149 @@
+#include "control-server.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <vector>
+
+static const int kMaxClients = 16;
+static const int kPollTimeoutMs = 250;  // How often to check for shutdown.
+
+ControlServer *ControlServer::Create(const char *socket_path,
+                                     int appendages) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return NULL;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("control socket");
+        return NULL;
+    }
+    unlink(socket_path);  // Leftover from previous run.
+    // Explicit mode, independent of the umask we were started with.
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+        || chmod(socket_path, NOODLY_CONTROL_SOCKET_MODE) < 0
+        || listen(fd, kMaxClients) < 0) {
+        perror("control socket bind");
+        close(fd);
+        return NULL;
+    }
+    return new ControlServer(socket_path, appendages, fd);
+}
+
+ControlServer::ControlServer(const char *socket_path, int appendages,
+                             int listen_fd)
+    : socket_path_(socket_path), appendages_(appendages),
+      listen_fd_(listen_fd), running_(true),
+      frames_(0), overruns_(0), max_frame_usec_(0), commands_applied_(0),
+      active_animations_(0), p99_frame_usec_(0), p999_frame_usec_(0),
+      commands_dropped_(0) {
+    thread_ = std::thread(&ControlServer::Run, this);
+}
+
+ControlServer::~ControlServer() {
+    running_ = false;
+    thread_.join();
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+}
+
+void ControlServer::PublishStatus(const control_status_t &status) {
+    frames_.store(status.frames, std::memory_order_relaxed);
+    overruns_.store(status.overruns, std::memory_order_relaxed);
+    max_frame_usec_.store(status.max_frame_usec, std::memory_order_relaxed);
+    commands_applied_.store(status.commands_applied,
+                            std::memory_order_relaxed);
+    active_animations_.store(status.active_animations,
+                             std::memory_order_relaxed);
+    p99_frame_usec_.store(status.p99_frame_usec, std::memory_order_relaxed);
+    p999_frame_usec_.store(status.p999_frame_usec, std::memory_order_relaxed);
+}
+
+bool ControlServer::IsValid(const control_command_t &command) const {
+    switch (command.request) {
+    case CONTROL_PULSE:
+        return command.appendage == CONTROL_PULSE_TOUCH
+            || command.appendage < appendages_;
+    case CONTROL_SET_IDLE:
+    case CONTROL_RESET_STATS:
+        return true;
+    case CONTROL_SET_PALETTE:
+        return command.palette.count <= NOODLY_CONTROL_MAX_COLORS;
+    case CONTROL_SET_ORB_SEQUENCE:
+        return command.orb_sequence.count > 0
+            && command.orb_sequence.count <= ORB_MAX_SEQUENCE;
+    default:
+        return false;
+    }
+}
+
+bool ControlServer::HandleRequest(int fd) {
+    control_command_t command;
+    const ssize_t len = recv(fd, &command, sizeof(command), 0);
+    if (len <= 0)
+        return false;
+
+    control_reply_t reply;
+    memset(&reply, 0, sizeof(reply));
+    if (len == sizeof(command) && command.request == CONTROL_GET_STATUS) {
+        reply.ok = 1;
+    } else if (len == sizeof(command) && IsValid(command)) {
+        reply.ok = ring_.Push(command);
+        if (!reply.ok) ++commands_dropped_;
+    }
+
+    reply.status.frames = frames_.load(std::memory_order_relaxed);
+    reply.status.overruns = overruns_.load(std::memory_order_relaxed);
+    reply.status.max_frame_usec
+        = max_frame_usec_.load(std::memory_order_relaxed);
+    reply.status.commands_applied
+        = commands_applied_.load(std::memory_order_relaxed);
+    reply.status.commands_dropped = commands_dropped_;
+    reply.status.active_animations
+        = active_animations_.load(std::memory_order_relaxed);
+    reply.status.p99_frame_usec
+        = p99_frame_usec_.load(std::memory_order_relaxed);
+    reply.status.p999_frame_usec
+        = p999_frame_usec_.load(std::memory_order_relaxed);
+    return send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) == sizeof(reply);
+}
+
+void ControlServer::Run() {
+    // First entry is the listening socket, then all the clients.
+    std::vector<struct pollfd> fds;
+    fds.push_back({ listen_fd_, POLLIN, 0 });
+    while (running_) {
+        if (poll(fds.data(), fds.size(), kPollTimeoutMs) <= 0)
+            continue;
+
+        for (size_t i = 1; i < fds.size(); /**/) {
+            if (fds[i].revents && !HandleRequest(fds[i].fd)) {
+                close(fds[i].fd);
+                fds.erase(fds.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            const int client = accept4(listen_fd_, NULL, NULL, SOCK_CLOEXEC);
+            if (client >= 0 && (int) fds.size() > kMaxClients) {
+                close(client);  // Sorry, too busy.
+            } else if (client >= 0) {
+                fds.push_back({ client, POLLIN, 0 });
+            }
+        }
+    }
+    for (size_t i = 1; i < fds.size(); ++i) {
+        close(fds[i].fd);
+    }
+}
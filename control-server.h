@@ -0,0 +1,67 @@
+// Server side of the local control channel (see control-protocol.h).
+//
+// A background thread serves the unix domain socket and queues commands in
+// a CommandRing. The render loop picks them up at frame boundaries with
+// NextCommand() and publishes its status with PublishStatus(); neither
+// takes a lock nor does a syscall.
+
+#ifndef NOODLY_CONTROL_SERVER_H_
+#define NOODLY_CONTROL_SERVER_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "command-ring.h"
+#include "control-protocol.h"
+
+class ControlServer {
+public:
+    ~ControlServer();
+
+    // Listen on the given socket path and start serving. Pulses are only
+    // accepted for appendages below "appendages". Returns NULL on failure.
+    static ControlServer *Create(const char *socket_path, int appendages);
+
+    // Render loop: get the next pending command. Returns false if there is
+    // none.
+    bool NextCommand(control_command_t *command) {
+        return ring_.Pop(command);
+    }
+
+    // Render loop: publish the current status to be returned to clients.
+    // The commands_dropped field is maintained by the server.
+    void PublishStatus(const control_status_t &status);
+
+private:
+    ControlServer(const char *socket_path, int appendages, int listen_fd);
+
+    void Run();
+
+    // Handle one request on client connection. Returns false if the
+    // connection should be closed.
+    bool HandleRequest(int fd);
+
+    // Returns if command is valid to be queued.
+    bool IsValid(const control_command_t &command) const;
+
+    const std::string socket_path_;
+    const int appendages_;
+    const int listen_fd_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+
+    CommandRing<control_command_t, 256> ring_;
+
+    // Status as published by render loop.
+    std::atomic<uint32_t> frames_;
+    std::atomic<uint32_t> overruns_;
+    std::atomic<uint32_t> max_frame_usec_;
+    std::atomic<uint32_t> commands_applied_;
+    std::atomic<uint32_t> active_animations_;
+    std::atomic<uint32_t> p99_frame_usec_;
+    std::atomic<uint32_t> p999_frame_usec_;
+    uint32_t commands_dropped_;  // Only accessed by server thread.
+};
+
+#endif  // NOODLY_CONTROL_SERVER_H_
@@ -5,6 +5,7 @@
 
 #include "microorb.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <algorithm>
@@ -32,6 +33,49 @@ static const int kUsbOrbProduct = 0xF00D;  // Thinking of lunch already ?
 
 namespace orb_driver {
 
+EepromShadow::EepromShadow() {
+  memset(data_, 0, sizeof(data_));
+  memset(known_, 0, sizeof(known_));
+}
+
+bool EepromShadow::Load(const std::string &filename) {
+  FILE *in = fopen(filename.c_str(), "rb");
+  bool success = false;
+  if (in) {
+    success = (fread(data_, sizeof(data_), 1, in) == 1
+               && fread(known_, sizeof(known_), 1, in) == 1);
+    fclose(in);
+  }
+  if (!success) memset(known_, 0, sizeof(known_));
+  return success;
+}
+
+bool EepromShadow::Save(const std::string &filename) const {
+  // Write to temp file first, so that we never end up with a half written
+  // shadow claiming things that are not in the EEPROM.
+  const std::string tmp = filename + ".tmp";
+  FILE *out = fopen(tmp.c_str(), "wb");
+  if (out == NULL) return false;
+  bool success = (fwrite(data_, sizeof(data_), 1, out) == 1
+                  && fwrite(known_, sizeof(known_), 1, out) == 1);
+  success &= (fclose(out) == 0);
+  if (success && rename(tmp.c_str(), filename.c_str()) == 0)
+    return true;
+  remove(tmp.c_str());
+  return false;
+}
+
+void EepromShadow::Set(int offset, const void *buffer, int len) {
+  assert(offset >= 0 && offset + len <= kSize);
+  memcpy(data_ + offset, buffer, len);
+  memset(known_ + offset, 1, len);
+}
+
+void EepromShadow::Forget(int offset, int len) {
+  assert(offset >= 0 && offset + len <= kSize);
+  memset(known_ + offset, 0, len);
+}
+
 void MicroOrb::UsbList(DeviceList *result) {
   usb_init();
   usb_find_busses();
@@ -243,16 +287,37 @@ bool MicroOrb::PokeEeprom(int eeprom_offset, const void *buffer, int len) {
   if (!IsOrb4()) return false;
   const int end_pos = eeprom_offset + len;
   if (eeprom_offset < 0 || len < 0 || end_pos > 128) return false;
+  const unsigned char *const bytes
+    = reinterpret_cast<const unsigned char*>(buffer);
   // we only can write in chunks of 7
   const int kChunkSize = 7;
-  for (int pos = eeprom_offset; pos < end_pos; pos += kChunkSize) {
-    int data_len = std::min(end_pos - pos, kChunkSize);
+  int i = 0;  // Position in buffer.
+  while (i < len) {
+    // Skip what is known to be stored already.
+    if (eeprom_shadow_
+        && eeprom_shadow_->Matches(eeprom_offset + i, bytes[i])) {
+      ++i;
+      continue;
+    }
+    // Chunk starts with a difference; end it at the last difference in reach.
+    const int pos = eeprom_offset + i;
+    int data_len = std::min(len - i, kChunkSize);
+    while (eeprom_shadow_ && data_len > 1
+           && eeprom_shadow_->Matches(pos + data_len - 1,
+                                      bytes[i + data_len - 1])) {
+      --data_len;
+    }
     char poke_data[kChunkSize + 1];
     poke_data[0] = pos;
-    const char *char_buf = reinterpret_cast<const char*>(buffer);
-    memcpy(poke_data + 1, char_buf + pos - eeprom_offset, data_len);
-    if (!Send(ORB_POKE_EEPROM, poke_data, 1 + data_len))
+    memcpy(poke_data + 1, bytes + i, data_len);
+    if (!Send(ORB_POKE_EEPROM, poke_data, 1 + data_len)) {
+      // Some or all of it might have been written nevertheless.
+      if (eeprom_shadow_) eeprom_shadow_->Forget(pos, data_len);
       return false;
+    }
+    if (eeprom_shadow_) eeprom_shadow_->Set(pos, bytes + i, data_len);
+    eeprom_bytes_written_ += data_len;
+    i += data_len;
   }
   return true;
 }
@@ -17,6 +17,37 @@ struct usb_dev_handle;
 
 namespace orb_driver {
 
+// Image of what is known to be stored in the EEPROM of an orb. The orb
+// can't be asked for its EEPROM content, so this is kept on disk per serial
+// number. Bytes never written through the shadow are unknown.
+class EepromShadow {
+ public:
+  static const int kSize = 128;
+
+  EepromShadow();
+
+  // Load image from file. Returns success; on failure, all is unknown.
+  bool Load(const std::string &filename);
+
+  // Save image to file. Returns success.
+  bool Save(const std::string &filename) const;
+
+  // Returns if the byte at offset is known to have the given value.
+  bool Matches(int offset, unsigned char value) const {
+    return known_[offset] && data_[offset] == value;
+  }
+
+  // Record bytes that have been written to the EEPROM.
+  void Set(int offset, const void *buffer, int len);
+
+  // Mark bytes as unknown, e.g. after a write that might have failed.
+  void Forget(int offset, int len);
+
+ private:
+  unsigned char data_[kSize];
+  unsigned char known_[kSize];
+};
+
 class MicroOrb {
  public:
 
@@ -68,8 +99,16 @@ class MicroOrb {
 
   // Poke data into the orb's eeprom if supported. Do only if you know
   // what'ya doing.
+  // With an EepromShadow set, only chunks that differ are written.
   bool PokeEeprom(int offset, const void *buffer, int len);
 
+  // Set shadow of this orb's EEPROM to skip writing unchanged data. It is
+  // updated with everything written. Not owned; NULL to always write all.
+  void SetEepromShadow(EepromShadow *shadow) { eeprom_shadow_ = shadow; }
+
+  // Number of bytes actually written to EEPROM so far.
+  int eeprom_bytes_written() const { return eeprom_bytes_written_; }
+
   // Switch off current limiting if supported. That will operate the orb
   // outside the USB specification; dangerous on USB hubs that don't support
   // that. This setting is stored in EEPROM, thus survives a 'reboot' of Orb.
@@ -80,7 +119,8 @@ class MicroOrb {
 
  private:
   MicroOrb(struct usb_device *device, struct usb_dev_handle *handle)
-      : device_(device), handle_(handle) {}
+      : device_(device), handle_(handle), eeprom_shadow_(NULL),
+        eeprom_bytes_written_(0) {}
 
   bool Send(enum OrbRequest command, const void* input, size_t data_len);
   bool Receive(enum OrbRequest command, void* buffer, size_t buffer_len);
@@ -96,6 +136,8 @@ class MicroOrb {
   const struct usb_device *const device_;  // not owned.
   struct usb_dev_handle *const handle_;  // allocated by usb_open()/usb_close()
   std::string serial_;
+  EepromShadow *eeprom_shadow_;  // not owned.
+  int eeprom_bytes_written_;
 };
 
 }  // end namespace orb_driver
@@ -0,0 +1,176 @@
+// Command line tool to control a running noodly. Also serves as load test
+// for the control channel with the 'flood' command.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "control-client.h"
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [-s <socket>] <command> [args]\n", progname);
+    fprintf(stderr, "Commands:\n"
+            "  status\n"
+            "  pulse [<appendage>]      : default: like touch.\n"
+            "  palette <bg> <color>...  : colors as RRGGBB hex.\n"
+            "  orb <RRGGBB:morph:hold>...\n"
+            "  idle <idle-sec> <repeat-sec>\n"
+            "  reset-stats              : reset max frame time and "
+            "percentiles.\n"
+            "  flood <count> [<per-sec>] : load test; send a mix of pulse,\n"
+            "        palette and orb commands at given rate (default: "
+            "5000/s).\n"
+            "        Resets stats first, so frame times are for the test.\n"
+            "        Fails if any command is rejected or a frame overruns.\n");
+    return 1;
+}
+
+static void PrintStatus(const control_status_t &s) {
+    printf("frames=%u overruns=%u max-frame-usec=%u p99-frame-usec=%u "
+           "p99.9-frame-usec=%u applied=%u dropped=%u active=0x%02x\n",
+           s.frames, s.overruns, s.max_frame_usec, s.p99_frame_usec,
+           s.p999_frame_usec, s.commands_applied, s.commands_dropped,
+           s.active_animations);
+}
+
+static double Now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// The flood load test mixes in palette and orb sequence commands. It sets
+// noodly's defaults, so that the show looks the same afterwards.
+static const uint32_t kDefaultBackground = 0xffff00;
+static const uint32_t kDefaultColors[] = {
+    0xA000FF, 0x0000FF, 0x00FF00, 0xFFFF00, 0xFF9000, 0xFF0000,
+};
+static const orb_sequence_t kDefaultEyeSequence = {
+    8,
+    {
+        { {0xff, 0x00, 0x00 }, 2, 1 },
+        { {0xff, 0xff, 0x00 }, 2, 1 },
+        { {0x00, 0xff, 0x00 }, 2, 1 },
+        { {0x00, 0x00, 0xff }, 2, 1 },
+        { {0xa0, 0x00, 0xff }, 2, 1 },
+        { {0xff, 0xff, 0xff }, 10, 255 },
+        { {0xff, 0xff, 0xff }, 0, 255 },
+        { {0xff, 0xff, 0xff }, 0, 255 },
+    }
+};
+// Pulses rotate through the outer appendages. The touch strip is left out:
+// a rainbow arriving at the eye would start sounds.
+static const int kFloodAppendages = 7;
+
+// Send one of the mixed commands of the flood load test.
+static bool FloodCommand(ControlClient *client, int i) {
+    switch (i % 4) {
+    case 0:
+        return client->SetPalette(kDefaultBackground, kDefaultColors,
+                                  sizeof(kDefaultColors)
+                                  / sizeof(kDefaultColors[0]));
+    case 1:
+        return client->SetOrbSequence(kDefaultEyeSequence);
+    default:
+        return client->Pulse(i % kFloodAppendages);
+    }
+}
+
+static int Flood(ControlClient *client, int count, int per_sec) {
+    control_status_t before, after;
+    if (!client->ResetStats() || !client->GetStatus(&before)) return 1;
+    const double start = Now();
+    int rejected = 0;
+    for (int i = 0; i < count; ++i) {
+        const double ahead = start + 1.0 * i / per_sec - Now();
+        if (ahead > 0) usleep(ahead * 1e6);
+        if (!FloodCommand(client, i)) ++rejected;
+    }
+    const double duration = Now() - start;
+    // Let render loop catch up with the queue and update the percentiles,
+    // which happens every NOODLY_CONTROL_PERCENTILE_FRAMES frames of 10ms.
+    usleep(2 * NOODLY_CONTROL_PERCENTILE_FRAMES * 10000);
+    if (!client->GetStatus(&after)) return 1;
+    const uint32_t dropped = after.commands_dropped - before.commands_dropped;
+    printf("%d commands in %.3fs: %.0f commands/s; %d rejected "
+           "(%u as queue was full).\n",
+           count, duration, count / duration, rejected, dropped);
+    printf("frames=%u overruns=%u during test; max-frame-usec=%u "
+           "p99-frame-usec=%u p99.9-frame-usec=%u\n",
+           after.frames - before.frames, after.overruns - before.overruns,
+           after.max_frame_usec, after.p99_frame_usec, after.p999_frame_usec);
+    if (rejected > 0 || dropped > 0)
+        return 2;
+    return after.overruns == before.overruns ? 0 : 2;
+}
+
+int main(int argc, char *argv[]) {
+    const char *socket_path = NOODLY_CONTROL_SOCKET;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's': socket_path = optarg; break;
+        default: return usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        return usage(argv[0]);
+    const char *command = argv[optind];
+    const int nargs = argc - optind - 1;
+    char **args = argv + optind + 1;
+
+    ControlClient *client = ControlClient::Connect(socket_path);
+    if (client == NULL) {
+        fprintf(stderr, "Can't connect to %s\n", socket_path);
+        return 1;
+    }
+
+    bool ok = false;
+    if (strcmp(command, "status") == 0) {
+        control_status_t status;
+        ok = client->GetStatus(&status);
+    } else if (strcmp(command, "pulse") == 0) {
+        ok = client->Pulse(nargs > 0 ? atoi(args[0]) : CONTROL_PULSE_TOUCH);
+    } else if (strcmp(command, "palette") == 0 && nargs >= 1
+               && nargs <= NOODLY_CONTROL_MAX_COLORS + 1) {
+        uint32_t colors[NOODLY_CONTROL_MAX_COLORS];
+        for (int i = 1; i < nargs; ++i)
+            colors[i - 1] = strtoul(args[i], NULL, 16);
+        ok = client->SetPalette(strtoul(args[0], NULL, 16),
+                                colors, nargs - 1);
+    } else if (strcmp(command, "orb") == 0 && nargs >= 1
+               && nargs <= ORB_MAX_SEQUENCE) {
+        orb_sequence_t sequence;
+        memset(&sequence, 0, sizeof(sequence));
+        sequence.count = nargs;
+        for (int i = 0; i < nargs; ++i) {
+            unsigned int rgb, morph, hold;
+            if (sscanf(args[i], "%x:%u:%u", &rgb, &morph, &hold) != 3)
+                return usage(argv[0]);
+            sequence.period[i].color.red = (rgb >> 16) & 0xff;
+            sequence.period[i].color.green = (rgb >> 8) & 0xff;
+            sequence.period[i].color.blue = rgb & 0xff;
+            sequence.period[i].morph_time = morph;
+            sequence.period[i].hold_time = hold;
+        }
+        ok = client->SetOrbSequence(sequence);
+    } else if (strcmp(command, "reset-stats") == 0) {
+        ok = client->ResetStats();
+    } else if (strcmp(command, "idle") == 0 && nargs == 2) {
+        ok = client->SetIdle(atoi(args[0]), atoi(args[1]));
+    } else if (strcmp(command, "flood") == 0 && nargs >= 1) {
+        const int per_sec = nargs > 1 ? atoi(args[1]) : 5000;
+        if (per_sec <= 0) return usage(argv[0]);
+        return Flood(client, atoi(args[0]), per_sec);
+    } else {
+        return usage(argv[0]);
+    }
+
+    PrintStatus(client->last_status());
+    if (!ok)
+        fprintf(stderr, "Command rejected.\n");
+    delete client;
+    return ok ? 0 : 1;
+}
@@ -1,10 +1,16 @@
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <libgen.h>
 
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
 #include <vector>
 
 // LED strip Libraries
@@ -17,6 +23,12 @@
 // Microorb
 #include "microorb.h"
 
+#include "audio-envelope.h"
+#include "command-ring.h"
+#include "control-server.h"
+#include "realtime.h"
+#include "spatial-effects.h"
+
 using namespace spixels;
 using namespace orb_driver;
 
@@ -25,6 +37,13 @@ using namespace orb_driver;
 #define SOUND_BINARY "/usr/bin/aplay"  // Binary to run
 #define IDLE_TIME_SEC 30               // Idle seconds to start idle mode
 #define IDLE_REPEAT_SEC 5               // Idle seconds to start idle mode
+#define FRAME_USEC 10000               // Time between frames.
+#define SIDE_EFFECT_POLL_USEC 5000     // Latency of sound and orb updates.
+
+// Real-time mode (option -r): render loop scheduled SCHED_FIFO with this
+// priority on the last CPU, with this much heap locked in memory up-front.
+#define REALTIME_PRIORITY 50
+#define REALTIME_HEAP_RESERVE (16 << 20)
 
 // After we have set up GPIO, we drop privileges to this user, as we execute
 // the aplay binary later. User 1000 is just the default pi user.
@@ -37,14 +56,25 @@ using namespace orb_driver;
 #define NOODLY_RETRIGGER false         // 'true' to allow retrigger
 #define NOODLY_PIXEL_REPEAT 2          // repeating pixels on strip.
 
-// The sequence of colors we play starting from the outside in.
-static uint32_t kAnimationColors[] = {
-    0xA000FF,  // violet
-    0x0000FF,  // blue
-    0x00FF00,  // green
-    0xFFFF00,  // yellow
-    0xFF9000,  // orange
-    0xFF0000,  // red
+// While a sound plays, brightness follows its loudness down to this fraction
+// and the rainbow runs at full speed while the bass is above threshold.
+#define SOUND_MIN_BRIGHTNESS 0.4
+#define SOUND_BASS_THRESHOLD 160       // 0..255
+#define ENVELOPE_CACHE_DIR "/var/cache/noodly"  // Analyzed sounds.
+
+// Background color and the sequence of colors we play starting from the
+// outside in. Can be changed at runtime via the control channel.
+static control_palette_t current_palette = {
+    NOODLY_DEFAULT_COLOR,
+    6,   // Number of colors below.
+    {
+        0xA000FF,  // violet
+        0x0000FF,  // blue
+        0x00FF00,  // green
+        0xFFFF00,  // yellow
+        0xFF9000,  // orange
+        0xFF0000,  // red
+    }
 };
 
 // Essentially, when we reach the eye, we just play the same sequence,
@@ -70,11 +100,13 @@ static orb_sequence_t kEyeOrbSequence = {
 
 // Multiplexed animation: Every LEDStripAnimation handles its own animation.
 // It gets regular timeslice call to UpdateAnimationFrame() in which it can
-// update its state.
+// update its state. The pixels are computed by the shaders in
+// spatial-effects.h over the geometry of this appendage.
 class LEDStripAnimation {
 public:
     LEDStripAnimation(LEDStrip *strip, bool forward)
-        : strip_(strip), random_per_strip_(random()), dir_(forward),
+        : strip_(strip), geometry_(strip->count()),
+          pixels_(strip->count()), random_per_strip_(random()), dir_(forward),
           animation_pos_(-1), animation_clock_(0) {}
 
     // Trigger a new animation.
@@ -86,44 +118,57 @@ public:
         }
     }
 
-    // Update the output. Called once per time-slice.
+    // Returns if there is currently a rainbow running.
+    bool IsActive() const { return animation_pos_ >= 0; }
+
+    // Update the output. Called once per time-slice; the animation advances
+    // only every "slowdown" slices. All pixels are scaled by "brightness".
     // Returns true when last animation phase is done.
-    bool UpdateAnimationFrame() {
+    bool UpdateAnimationFrame(float brightness, int slowdown) {
         // We only update on every other
-        if ((animation_clock_++ % NOODLY_ANIMATION_SLOWDOWN) != 0)
+        if ((animation_clock_++ % slowdown) != 0)
             return false;
 
+        const bool reached_end = ShadeFrame();
+        if (brightness < 1.0f)
+            ShadeBrightness(geometry_, brightness, pixels_.data());
+        for (int i = 0; i < geometry_.count; ++i) {
+            strip_->SetPixel(i, pixels_[i]);
+        }
+        return reached_end;
+    }
+
+private:
+    // Render the current frame into pixels_.
+    bool ShadeFrame() {
         // Regular background effect. Some sinusoidal wave.
         // We don't want all LED strips be in
         // phase, so we have some randomness per strip.
         const uint32_t background_phase
-            = (random_per_strip_ + animation_clock_/2) % strip_->count();
-        for (int i = 0; i < strip_->count(); ++i) {
-            float fraction = (3.0 * i + background_phase) / strip_->count();
-            float position_bright = cosf(2 * M_PI * fraction);
-            uint8_t col = (position_bright + 1) * 63 + 64;
-            strip_->SetPixel(i, (col << 16) | (col << 8) | 0);
-        }
+            = (random_per_strip_ + animation_clock_/2) % geometry_.count;
+        ShadeCosineWave(geometry_, 3, 1.0f * background_phase / geometry_.count,
+                        current_palette.background, pixels_.data());
 
         // Current active animation, walking up the strip.
         if (animation_pos_ < 0)
             return false;
 
-        // Rainbow
-        int col_pos = animation_pos_-1;
-        for (uint32_t color : kAnimationColors) {
-            for (int i = 0; i < NOODLY_PIXEL_REPEAT; ++i) {
-                const int pos = col_pos--;
-                strip_->SetPixel(dir_ ? strip_->count() - pos : pos, color);
-            }
-        }
+        // Rainbow. Forward strips animate from the eye outwards, backward
+        // ones towards the eye.
+        const float tail = dir_
+            ? geometry_.count - animation_pos_ + 1
+            : animation_pos_ - 1;
+        ShadeBand(geometry_, tail, dir_ ? 1 : -1,
+                  current_palette.colors, current_palette.count,
+                  NOODLY_PIXEL_REPEAT, pixels_.data());
 
         animation_pos_--;
         return animation_pos_ == -1;
     }
 
-private:
     LEDStrip *const strip_;
+    const StripGeometry geometry_;
+    std::vector<uint32_t> pixels_;
     const uint32_t random_per_strip_;
     const bool dir_;
 
@@ -163,18 +208,127 @@ static void PlaySound(const std::string &file) {
     system(buffer);
 }
 
+static int64_t MonotonicUsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// In real-time mode, things that take long - forking aplay and the USB
+// transfers to the orbs - are handed to this thread, so that they never hold
+// up a frame.
+class SideEffectThread {
+public:
+    struct Job {
+        const std::string *sound;  // Sound file to play or NULL. Not owned.
+        bool set_eyes;             // Set eye_sequence on all eyes.
+        orb_sequence_t eye_sequence;
+    };
+
+    explicit SideEffectThread(const std::vector<MicroOrb*> &eyes)
+        : eyes_(eyes), sounds_started_(0), last_sound_start_(0),
+          running_(true), thread_(&SideEffectThread::Run, this) {}
+
+    ~SideEffectThread() {
+        running_ = false;
+        thread_.join();
+    }
+
+    // Render loop: queue job. Never blocks; returns false if queue is full.
+    bool Submit(const Job &job) { return jobs_.Push(job); }
+
+    // Render loop: number of sounds started so far, and the MonotonicUsec()
+    // the last one of them was started at. A sound is only started once
+    // its job is picked up, which might be a few frames after Submit().
+    uint32_t sounds_started() const {
+        return sounds_started_.load(std::memory_order_acquire);
+    }
+    int64_t last_sound_start() const {
+        return last_sound_start_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Run() {
+        Job job;
+        while (running_) {
+            if (!jobs_.Pop(&job)) {
+                usleep(SIDE_EFFECT_POLL_USEC);
+                continue;
+            }
+            if (job.sound) {
+                PlaySound(*job.sound);
+                last_sound_start_.store(MonotonicUsec(),
+                                        std::memory_order_relaxed);
+                sounds_started_.fetch_add(1, std::memory_order_release);
+            }
+            if (job.set_eyes) {
+                for (auto e : eyes_)
+                    e->SetSequence(job.eye_sequence);
+            }
+        }
+    }
+
+    const std::vector<MicroOrb*> eyes_;
+    CommandRing<Job, 16> jobs_;
+    std::atomic<uint32_t> sounds_started_;
+    std::atomic<int64_t> last_sound_start_;
+    std::atomic<bool> running_;
+    std::thread thread_;  // Last, so that it starts with all set up.
+};
+
+static void SleepUntilUsec(int64_t usec) {
+    struct timespec ts;
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    int err;
+    while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+           == EINTR)
+        ;  // Interrupted; continue sleeping.
+    if (err != 0) {
+        // Shouldn't happen; rather sleep imprecisely than spin.
+        const int64_t remaining = usec - MonotonicUsec();
+        if (remaining > 0) usleep(remaining);
+    }
+}
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [-r] [<sound-file>...]\n", progname);
+    fprintf(stderr, "  -r : real-time mode: locked memory, SCHED_FIFO.\n"
+            "Sound files starting with 'touch' are played on touch, the "
+            "others in idle mode.\n");
+    return 1;
+}
+
 int main(int argc, char *argv[]) {
     std::vector<std::string> touchFiles;
     std::vector<std::string> idleFiles;
-    for (int i = 1; i < argc; ++i) {
+    std::vector<AudioEnvelope*> touchEnvelopes;
+    std::vector<AudioEnvelope*> idleEnvelopes;
+    bool realtime = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        switch (opt) {
+        case 'r': realtime = true; break;
+        default: return usage(argv[0]);
+        }
+    }
+    for (int i = optind; i < argc; ++i) {
 	std::string name = basename(argv[i]);
 
+	// Analyzed once, then cached in ENVELOPE_CACHE_DIR.
+	AudioEnvelope *envelope = AudioEnvelope::Load(argv[i],
+						      ENVELOPE_CACHE_DIR);
+	if (envelope == NULL)
+	    fprintf(stderr, "Can't analyze %s; no light sync.\n", argv[i]);
+
 	if (name.find("touch") == 0) {
         	fprintf(stderr, "Adding touch sound file %s\n", argv[i]);
 		touchFiles.push_back(argv[i]);
+		touchEnvelopes.push_back(envelope);
 	} else {
         	fprintf(stderr, "Adding idle sound file %s\n", argv[i]);
 		idleFiles.push_back(argv[i]);
+		idleEnvelopes.push_back(envelope);
 	}
     }
     auto eyes = GetAvailableEyes();
@@ -203,10 +357,72 @@ int main(int argc, char *argv[]) {
 
     static constexpr int kTouchStrip = 7;
 
+    // Needs to happen while we're still root.
+    if (realtime && !PrepareRealtime(REALTIME_HEAP_RESERVE,
+                                     REALTIME_PRIORITY)) {
+        fprintf(stderr, "Can't prepare real-time mode.\n");
+        return 1;
+    }
+
     // Drop privs
     setresuid(PI_USER, PI_USER, PI_USER);
     setresgid(PI_USER, PI_USER, PI_USER);
 
+    // Show controllers on the same box can remote control us.
+    ControlServer *const control
+        = ControlServer::Create(NOODLY_CONTROL_SOCKET, NOODLY_APPENDAGES);
+    if (control == NULL) {
+        fprintf(stderr, "Can't open control socket %s; continuing without.\n",
+                NOODLY_CONTROL_SOCKET);
+    }
+    SideEffectThread *const side_effects
+        = realtime ? new SideEffectThread(eyes) : NULL;
+
+    // Only now, after other threads are started, as they'd inherit it.
+    if (realtime && !EnterRealtime(sysconf(_SC_NPROCESSORS_ONLN) - 1,
+                                   REALTIME_PRIORITY)) {
+        return 1;
+    }
+
+    control_status_t status = {};
+    FrameTimeHistogram frame_times;
+    int64_t last_frame_start = 0;
+    int64_t next_frame = MonotonicUsec();
+    orb_sequence_t eye_sequence = kEyeOrbSequence;
+    int idle_sec = IDLE_TIME_SEC;
+    int idle_repeat_sec = IDLE_REPEAT_SEC;
+    const AudioEnvelope *playing = NULL;  // Envelope of sound being played.
+    int64_t playing_start = 0;  // 0: not yet started by side effect thread.
+    uint32_t sounds_submitted = 0;
+
+    // Play a random one of "files" (if any) and set the eye sequence. In
+    // real-time mode, this is skipped if the side effect thread is too busy.
+    auto trigger_side_effects = [&](
+        const std::vector<std::string> &files,
+        const std::vector<AudioEnvelope*> &envelopes) {
+        SideEffectThread::Job job = { NULL, true, eye_sequence };
+        int index = 0;
+        if (!files.empty()) {
+            index = random() % files.size();
+            job.sound = &files[index];
+        }
+        if (side_effects == NULL) {
+            if (job.sound) {
+                PlaySound(*job.sound);
+                playing = envelopes[index];
+                playing_start = MonotonicUsec();
+            }
+            for (auto e : eyes)
+                e->SetSequence(eye_sequence);
+            return;
+        }
+        if (!side_effects->Submit(job) || job.sound == NULL)
+            return;
+        playing = envelopes[index];
+        playing_start = 0;
+        ++sounds_submitted;
+    };
+
     timeval current_time;
     __time_t last_animation_sec;
     __time_t last_idle_sec;
@@ -218,16 +434,82 @@ int main(int argc, char *argv[]) {
     
 
     for (;;) {
-        usleep(10000);
+        if (realtime) {
+            // Fixed frame rate independent of how long the frame took. If
+            // we fell behind, don't try to catch up.
+            next_frame = std::max(next_frame + FRAME_USEC, MonotonicUsec());
+            SleepUntilUsec(next_frame);
+        } else {
+            usleep(FRAME_USEC);
+        }
+        const int64_t frame_start = MonotonicUsec();
+        if (last_frame_start)
+            frame_times.Add(frame_start - last_frame_start);
+        last_frame_start = frame_start;
+
+        // Apply commands from the control channel at the frame boundary.
+        bool touch_pulse = false;
+        control_command_t command;
+        while (control && control->NextCommand(&command)) {
+            switch (command.request) {
+            case CONTROL_PULSE:
+                if (command.appendage == CONTROL_PULSE_TOUCH)
+                    touch_pulse = true;
+                else if (command.appendage < NOODLY_APPENDAGES)
+                    animation[command.appendage]->StartAnimation(true);
+                break;
+            case CONTROL_SET_PALETTE:
+                current_palette = command.palette;
+                break;
+            case CONTROL_SET_ORB_SEQUENCE:
+                eye_sequence = command.orb_sequence;
+                break;
+            case CONTROL_SET_IDLE:
+                idle_sec = command.idle.idle_sec;
+                idle_repeat_sec = command.idle.repeat_sec;
+                break;
+            case CONTROL_RESET_STATS:
+                frame_times.Reset();
+                status.max_frame_usec = 0;
+                status.p99_frame_usec = 0;
+                status.p999_frame_usec = 0;
+                break;
+            }
+            status.commands_applied++;
+        }
 
         MPR121.updateTouchData();
 
         // First touch sensor triggers main LED
-        animation[kTouchStrip]->StartAnimation(MPR121.getTouchData(0));
+        animation[kTouchStrip]->StartAnimation(MPR121.getTouchData(0)
+                                               || touch_pulse);
+
+        // Follow the sound being played.
+        float brightness = 1.0f;
+        int slowdown = NOODLY_ANIMATION_SLOWDOWN;
+        if (playing && playing_start == 0
+            && side_effects->sounds_started() == sounds_submitted) {
+            playing_start = side_effects->last_sound_start();
+        }
+        // The sound might have been started after this frame started.
+        if (playing && playing_start && frame_start >= playing_start) {
+            const envelope_frame_t *level
+                = playing->AtTime(frame_start - playing_start);
+            if (level) {
+                brightness = SOUND_MIN_BRIGHTNESS
+                    + (1 - SOUND_MIN_BRIGHTNESS) * level->loudness / 255.0f;
+                if (std::max(level->bands[0], level->bands[1])
+                    > SOUND_BASS_THRESHOLD)
+                    slowdown = 1;
+            } else {
+                playing = NULL;  // Done.
+            }
+        }
 
         bool strip_reached_end[NOODLY_APPENDAGES] = {};
         for (int i = 0; i < NOODLY_APPENDAGES; ++i) {
-            strip_reached_end[i] = animation[i]->UpdateAnimationFrame();
+            strip_reached_end[i] = animation[i]->UpdateAnimationFrame(
+                brightness, slowdown);
         }
 
         // Alright, if the touch strip reached the end, we just animate out
@@ -255,26 +537,36 @@ int main(int argc, char *argv[]) {
         if (strip_reached_end[kTouchStrip]) {
             gettimeofday(&current_time, NULL);
             last_animation_sec = current_time.tv_sec;
-            if (!touchFiles.empty())
-                PlaySound(touchFiles[random() % touchFiles.size()]);
-            for (auto e : eyes)
-                e->SetSequence(kEyeOrbSequence);
+            trigger_side_effects(touchFiles, touchEnvelopes);
         } else {
             gettimeofday(&current_time, NULL);
             now_sec = current_time.tv_sec;
-            if ( now_sec - last_animation_sec > IDLE_TIME_SEC &&
-                 now_sec - last_idle_sec > IDLE_REPEAT_SEC ) {
+            if ( idle_sec > 0 &&
+                 now_sec - last_animation_sec > idle_sec &&
+                 now_sec - last_idle_sec > idle_repeat_sec ) {
                 // do something idle mode
                 last_idle_sec = now_sec;
-                if (!idleFiles.empty())
-                    PlaySound(idleFiles[random() % idleFiles.size()]);
-                for (auto e : eyes)
-                    e->SetSequence(kEyeOrbSequence);
+                trigger_side_effects(idleFiles, idleEnvelopes);
                 // printf("Idle!!! %u\n", now_sec);
 		fflush(stdout);
             }
         }
-            
+
+        const uint32_t frame_usec = MonotonicUsec() - frame_start;
+        status.frames++;
+        if (frame_usec > FRAME_USEC) status.overruns++;
+        if (frame_usec > status.max_frame_usec)
+            status.max_frame_usec = frame_usec;
+        if (status.frames % NOODLY_CONTROL_PERCENTILE_FRAMES == 0) {
+            status.p99_frame_usec = frame_times.Percentile(0.99);
+            status.p999_frame_usec = frame_times.Percentile(0.999);
+        }
+        status.active_animations = 0;
+        for (int i = 0; i < NOODLY_APPENDAGES; ++i) {
+            if (animation[i]->IsActive())
+                status.active_animations |= 1 << i;
+        }
+        if (control) control->PublishStatus(status);
     }
     return 0;
 }
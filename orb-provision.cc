@@ -0,0 +1,222 @@
+// Provision all connected orbs at once: current limit, initial sequence
+// and (with a single orb) serial number.
+//
+// For each orb, a shadow of its EEPROM is kept in a file named after its
+// serial number, so that re-provisioning only writes what changed. Shadows
+// are only created when setting the serial: orbs fresh from the factory
+// might all have the same one. Orbs without a shadow, or sharing their
+// serial with another connected orb, always get everything written.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "microorb.h"
+
+using namespace orb_driver;
+
+#define DEFAULT_SHADOW_DIR "/var/lib/noodly"
+
+struct ProvisionRequest {
+    std::string shadow_dir;
+    bool force;                    // Write everything, then update shadow.
+    std::string serial;            // Empty: keep serial.
+    int current_limit;             // -1: don't touch, 0: off, 1: on
+    bool set_sequence;
+    orb_sequence_t initial_sequence;
+};
+
+struct ProvisionResult {
+    std::string serial;
+    bool success;
+    int bytes_written;
+};
+
+static int usage(const char *progname) {
+    fprintf(stderr, "usage: %s [options] [<RRGGBB:morph:hold>...]\n",
+            progname);
+    fprintf(stderr, "Provisions all connected orbs concurrently. If colors "
+            "are given, they are stored as initial sequence.\n"
+            "Options:\n"
+            "  -d <dir>    : directory with EEPROM shadows (default: "
+            DEFAULT_SHADOW_DIR ")\n"
+            "  -l <on|off> : switch current limit.\n"
+            "  -S <serial> : set 7 character serial; only with one orb.\n"
+            "  -f          : write everything, regardless of shadows.\n");
+    return 1;
+}
+
+static std::string ShadowFile(const ProvisionRequest &request,
+                              const std::string &serial) {
+    return request.shadow_dir + "/" + serial + ".eeprom";
+}
+
+// Provision the opened orb, whose current serial is in "result".
+// "unique_serial" tells if no other connected orb has the same serial.
+static void Provision(MicroOrb *orb, bool unique_serial,
+                      const ProvisionRequest &request,
+                      ProvisionResult *result) {
+    // A new serial starts a new shadow. Otherwise, the shadow is only used
+    // if there is one, i.e. if the serial has been set by us before. With
+    // force, start with nothing known, so that everything is written and
+    // the saved shadow matches the orb again.
+    EepromShadow shadow;
+    bool use_shadow = !request.serial.empty();
+    if (!use_shadow && unique_serial && !result->serial.empty()) {
+        const std::string file = ShadowFile(request, result->serial);
+        use_shadow = access(file.c_str(), F_OK) == 0;
+        if (use_shadow && !request.force)
+            shadow.Load(file);
+    }
+    if (use_shadow)
+        orb->SetEepromShadow(&shadow);
+
+    bool success = true;
+    if (!request.serial.empty()) {
+        success &= orb->SetSerial(request.serial);
+        result->serial = request.serial;
+    }
+    if (request.current_limit >= 0)
+        success &= orb->SwitchCurrentLimit(request.current_limit);
+    if (request.set_sequence)
+        success &= orb->SetInitialSequence(request.initial_sequence);
+
+    // Even after failure, the shadow has what was written successfully.
+    if (use_shadow && !shadow.Save(ShadowFile(request, result->serial))) {
+        fprintf(stderr, "%s: can't save EEPROM shadow in %s\n",
+                result->serial.c_str(), request.shadow_dir.c_str());
+    }
+    result->success = success;
+    result->bytes_written = orb->eeprom_bytes_written();
+}
+
+int main(int argc, char *argv[]) {
+    ProvisionRequest request;
+    request.shadow_dir = DEFAULT_SHADOW_DIR;
+    request.force = false;
+    request.current_limit = -1;
+    request.set_sequence = false;
+    memset(&request.initial_sequence, 0, sizeof(request.initial_sequence));
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:l:S:f")) != -1) {
+        switch (opt) {
+        case 'd': request.shadow_dir = optarg; break;
+        case 'f': request.force = true; break;
+        case 'S':
+            request.serial = optarg;
+            if (request.serial.length() != 7) return usage(argv[0]);
+            break;
+        case 'l':
+            if (strcmp(optarg, "on") == 0) request.current_limit = 1;
+            else if (strcmp(optarg, "off") == 0) request.current_limit = 0;
+            else return usage(argv[0]);
+            break;
+        default: return usage(argv[0]);
+        }
+    }
+    const int colors = argc - optind;
+    if (colors > ORB_MAX_SEQUENCE)
+        return usage(argv[0]);
+    for (int i = 0; i < colors; ++i) {
+        unsigned int rgb, morph, hold;
+        if (sscanf(argv[optind + i], "%x:%u:%u", &rgb, &morph, &hold) != 3)
+            return usage(argv[0]);
+        orb_color_period_t &period = request.initial_sequence.period[i];
+        period.color.red = (rgb >> 16) & 0xff;
+        period.color.green = (rgb >> 8) & 0xff;
+        period.color.blue = rgb & 0xff;
+        period.morph_time = morph;
+        period.hold_time = hold;
+    }
+    request.initial_sequence.count = colors;
+    request.set_sequence = colors > 0;
+
+    // Fail before touching any orb, rather than not being able to save what
+    // was written.
+    if (mkdir(request.shadow_dir.c_str(), 0755) < 0
+        && errno != EEXIST) {
+        fprintf(stderr, "Can't create EEPROM shadow directory %s: %s\n",
+                request.shadow_dir.c_str(), strerror(errno));
+        return 1;
+    }
+    if (access(request.shadow_dir.c_str(), W_OK) < 0) {
+        fprintf(stderr, "Can't write EEPROM shadows to %s: %s\n",
+                request.shadow_dir.c_str(), strerror(errno));
+        return 1;
+    }
+
+    MicroOrb::DeviceList devices;
+    MicroOrb::UsbList(&devices);
+    if (devices.empty()) {
+        fprintf(stderr, "No orbs found.\n");
+        return 1;
+    }
+    if (!request.serial.empty() && devices.size() != 1) {
+        fprintf(stderr, "Setting serial requires exactly one orb; "
+                "found %d.\n", (int) devices.size());
+        return 1;
+    }
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    std::vector<MicroOrb*> orbs(devices.size());
+    std::vector<ProvisionResult> results(devices.size());
+    std::map<std::string, int> serial_count;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        results[i].success = false;
+        results[i].bytes_written = 0;
+        orbs[i] = MicroOrb::Open(devices[i]);
+        if (orbs[i] == NULL)
+            continue;
+        results[i].serial = orbs[i]->GetSerial();
+        serial_count[results[i].serial]++;
+    }
+
+    // Shadows are kept per serial, so they are only used if the serial
+    // identifies the orb: it might have been set on more than one.
+    for (std::map<std::string, int>::const_iterator it = serial_count.begin();
+         it != serial_count.end(); ++it) {
+        if (it->second > 1) {
+            fprintf(stderr, "%s: serial shared by %d orbs; not using "
+                    "EEPROM shadow, writing everything.\n",
+                    it->first.c_str(), it->second);
+        }
+    }
+
+    // USB transfers to the orbs are slow; talk to all of them in parallel.
+    std::vector<std::thread> threads(devices.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        if (orbs[i] == NULL)
+            continue;
+        const std::string &serial = results[i].serial;
+        const bool unique_serial = serial_count[serial] == 1;
+        threads[i] = std::thread(Provision, orbs[i], unique_serial,
+                                 std::cref(request), &results[i]);
+    }
+    int failures = 0;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        if (threads[i].joinable())
+            threads[i].join();
+        delete orbs[i];
+        printf("%-8s %-6s %3d EEPROM bytes written\n",
+               results[i].serial.empty() ? "?" : results[i].serial.c_str(),
+               results[i].success ? "ok" : "FAIL", results[i].bytes_written);
+        if (!results[i].success) ++failures;
+    }
+    gettimeofday(&end, NULL);
+    printf("%d orbs in %.1fs; %d failed.\n", (int) devices.size(),
+           end.tv_sec - start.tv_sec + (end.tv_usec - start.tv_usec) / 1e6,
+           failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include "realtime.h"
+
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static const size_t kStackPrefaultBytes = 256 << 10;
+
+// Touch stack pages, so that they are mapped (and locked) now.
+static void PrefaultStack() {
+    volatile char stack[kStackPrefaultBytes];
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+bool PrepareRealtime(size_t heap_reserve_bytes, int priority) {
+    const struct rlimit unlimited = { RLIM_INFINITY, RLIM_INFINITY };
+    const struct rlimit rtprio = { (rlim_t) priority, (rlim_t) priority };
+    if (setrlimit(RLIMIT_MEMLOCK, &unlimited) < 0
+        || setrlimit(RLIMIT_RTPRIO, &rtprio) < 0) {
+        perror("setrlimit");
+        return false;
+    }
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("mlockall");
+        return false;
+    }
+
+    // Keep malloc working within its arena: never trim memory back to the
+    // kernel and don't serve large blocks with separate mmap()s. Then
+    // grow the arena by the reserve and touch it, so that later
+    // allocations are served from memory that is already locked in.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    char *reserve = (char*) malloc(heap_reserve_bytes);
+    if (reserve == NULL)
+        return false;
+    for (size_t i = 0; i < heap_reserve_bytes; i += 4096)
+        reserve[i] = 0;
+    free(reserve);
+
+    PrefaultStack();
+    return true;
+}
+
+bool EnterRealtime(int cpu, int priority) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0) {
+        fprintf(stderr, "Can't pin to CPU %d: %s\n", cpu, strerror(err));
+        return false;
+    }
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        fprintf(stderr, "Can't set SCHED_FIFO: %s\n", strerror(err));
+        return false;
+    }
+    return true;
+}
+
+FrameTimeHistogram::FrameTimeHistogram() {
+    Reset();
+}
+
+void FrameTimeHistogram::Add(uint32_t usec) {
+    const uint32_t bucket = usec / kResolutionUsec;
+    buckets_[bucket < kBuckets ? bucket : kBuckets - 1]++;
+    count_++;
+}
+
+uint32_t FrameTimeHistogram::Percentile(double fraction) const {
+    if (count_ == 0)
+        return 0;
+    const uint64_t wanted = ceil(fraction * count_);
+    uint64_t sum = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        sum += buckets_[i];
+        if (sum >= wanted)
+            return (i + 1) * kResolutionUsec;
+    }
+    return kBuckets * kResolutionUsec;
+}
+
+void FrameTimeHistogram::Reset() {
+    count_ = 0;
+    memset(buckets_, 0, sizeof(buckets_));
+}
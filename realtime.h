@@ -0,0 +1,45 @@
+// Helpers to run the render loop without stutter: memory that is locked and
+// allocated up-front, a real-time scheduled render thread and statistics
+// to verify the frame timing.
+
+#ifndef NOODLY_REALTIME_H_
+#define NOODLY_REALTIME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Call while still root. Lock all current and future memory, reserve and
+// prefault "heap_reserve_bytes" in the malloc arena (which is then never
+// given back to the kernel) and raise the limits so that EnterRealtime()
+// works after dropping privileges. Returns success.
+bool PrepareRealtime(size_t heap_reserve_bytes, int priority);
+
+// Make the calling thread SCHED_FIFO with given priority and pin it to
+// "cpu". Threads created afterwards from it inherit this, so start other
+// threads first. Returns success.
+bool EnterRealtime(int cpu, int priority);
+
+// Histogram of frame times. Fixed size, so adding never allocates.
+class FrameTimeHistogram {
+public:
+    FrameTimeHistogram();
+
+    void Add(uint32_t usec);
+
+    // Time in microseconds that the given fraction (e.g. 0.99) of all
+    // frames did not exceed. Resolution is kResolutionUsec; longer frames
+    // than the histogram covers are counted in the last bucket.
+    uint32_t Percentile(double fraction) const;
+
+    // Forget all frames added so far.
+    void Reset();
+
+private:
+    static const int kResolutionUsec = 10;
+    static const int kBuckets = 10000;   // Up to 100ms
+
+    uint32_t count_;
+    uint32_t buckets_[kBuckets];
+};
+
+#endif  // NOODLY_REALTIME_H_
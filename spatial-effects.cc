@@ -0,0 +1,48 @@
+#include "spatial-effects.h"
+
+#include <math.h>
+
+StripGeometry::StripGeometry(int pixels)
+    : count(pixels), radius(pixels), along(pixels) {
+    for (int i = 0; i < count; ++i) {
+        radius[i] = i;
+        along[i] = 1.0f * i / count;
+    }
+}
+
+void ShadeCosineWave(const StripGeometry &geometry, float waves, float phase,
+                     uint32_t base_color, uint32_t *out) {
+    const float *const along = geometry.along.data();
+    const uint32_t r = (base_color >> 16) & 0xff;
+    const uint32_t g = (base_color >> 8) & 0xff;
+    const uint32_t b = base_color & 0xff;
+    for (int i = 0; i < geometry.count; ++i) {
+        const float position_bright
+            = cosf(2 * M_PI * (waves * along[i] + phase));
+        const uint32_t col = (uint8_t) ((position_bright + 1) * 63 + 64);
+        out[i] = ((r * col / 255) << 16) | ((g * col / 255) << 8)
+            | (b * col / 255);
+    }
+}
+
+void ShadeBand(const StripGeometry &geometry, float tail, int direction,
+               const uint32_t *colors, int num_colors, int repeat,
+               uint32_t *out) {
+    const float *const radius = geometry.radius.data();
+    const float width = num_colors * repeat;
+    for (int i = 0; i < geometry.count; ++i) {
+        const float d = direction * (radius[i] - tail);
+        if (d >= 0 && d < width)
+            out[i] = colors[(int) d / repeat];
+    }
+}
+
+void ShadeBrightness(const StripGeometry &geometry, float gain, uint32_t *out) {
+    const uint32_t scale = gain * 256;  // Fixed point 8.8
+    for (int i = 0; i < geometry.count; ++i) {
+        const uint32_t c = out[i];
+        out[i] = ((((c >> 16) & 0xff) * scale >> 8) << 16)
+            | ((((c >> 8) & 0xff) * scale >> 8) << 8)
+            | ((c & 0xff) * scale >> 8);
+    }
+}
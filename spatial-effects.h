@@ -0,0 +1,44 @@
+// Spatial pixel "shaders" for the noodly appendages.
+//
+// Every pixel of every strip is mapped to a position in one shared,
+// eye-centered coordinate space. The positions are precomputed once and
+// stored as separate arrays (structure of arrays), so that an effect is a
+// plain function looping over whole arrays at once instead of calling
+// something per pixel.
+
+#ifndef NOODLY_SPATIAL_EFFECTS_H_
+#define NOODLY_SPATIAL_EFFECTS_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+// Position of all pixels of one appendage. The appendages radiate from the
+// eye; pixel 0 is closest to it. Distances are in units of LED pitch.
+struct StripGeometry {
+    // Create geometry of a strip with "pixels" pixels.
+    explicit StripGeometry(int pixels);
+
+    int count;
+    std::vector<float> radius;  // Distance from the eye.
+    std::vector<float> along;   // Normalized position along strip [0..1)
+};
+
+// Background wave: brightness follows a cosine along the strip with
+// "waves" periods over its length, shifted by "phase" (in periods).
+// The brightness scales the given RGB base color and never goes fully dark.
+void ShadeCosineWave(const StripGeometry &geometry, float waves, float phase,
+                     uint32_t base_color, uint32_t *out);
+
+// Overlay a band of colors, each "repeat" pixels wide, starting at
+// radius "tail" and extending outwards (direction = 1) or
+// inwards (direction = -1). Pixels outside the band are left untouched.
+// With the same tail on all strips, this is a ring around the eye.
+void ShadeBand(const StripGeometry &geometry, float tail, int direction,
+               const uint32_t *colors, int num_colors, int repeat,
+               uint32_t *out);
+
+// Scale all color channels of the pixels by "gain" (0..1).
+void ShadeBrightness(const StripGeometry &geometry, float gain, uint32_t *out);
+
+#endif  // NOODLY_SPATIAL_EFFECTS_H_